@@ -0,0 +1,429 @@
+// Ray marching renders an implicit surface by stepping along each camera ray
+// until the surface is reached, so the fluid never has to be turned into a
+// triangle mesh.
+//
+// For SPH the implicit surface is an iso-surface of the density field:
+//   rho(x) = sum_j m_j * W(|x - x_j|, h)   with the poly6 kernel W,
+// and the fluid surface is where rho(x) = isoDensity.
+//
+// Density is not a distance, so plain sphere tracing does not apply directly.
+// The step sizes are kept safe with two bounds:
+//   - Far from particles the field is exactly zero. A uniform grid (cell size h)
+//     with a coarse occupancy hierarchy on top lets rays jump over whole empty
+//     blocks of cells at once.
+//   - Near particles, the step is (isoDensity - rho) divided by a local bound on
+//     |grad rho| (Lipschitz constant), so the ray can never step over the surface.
+// Normals come from the gradient of the kernel, and the image is rendered in
+// tiles on all CPU threads.
+
+
+
+
+
+
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+
+const int RM_TILE_SIZE = 16;         // Image tile edge in pixels
+const int OCCUPANCY_BRANCH = 4;      // Each coarse occupancy block covers 4x4x4 blocks of the finer level
+const int OCCUPANCY_LEVELS = 3;      // Cells, 4^3 blocks, 16^3 blocks
+
+struct RayMarchCamera {
+    glm::vec3 position;
+    glm::vec3 target;
+    glm::vec3 up;
+    float fovY;                      // Vertical field of view in radians
+};
+
+struct RayMarchSettings {
+    int width;
+    int height;
+    int numThreads;                  // <= 0 uses every hardware thread
+    float h;                         // Smoothing length
+    float mass;                      // Particle mass
+    float isoDensity;                // Density of the rendered surface, e.g. 0.5f * rho0
+    int maxSteps;
+    float minStep;                   // Lower bound on a step near the surface, in world units
+    glm::vec3 lightDir;              // Direction towards the light
+    glm::vec3 fluidColor;
+    glm::vec3 background;
+
+    RayMarchSettings()
+        : width(640), height(480), numThreads(0), h(0.02f), mass(0.02f), isoDensity(500.0f),
+          maxSteps(512), minStep(1e-4f), lightDir(0.3f, 1.0f, 0.5f),
+          fluidColor(0.1f, 0.4f, 0.9f), background(0.0f, 0.0f, 0.0f) {}
+};
+
+// One level of the occupancy hierarchy. Level 0 has one entry per grid cell and
+// marks cells where the density can be non-zero; level i merges
+// OCCUPANCY_BRANCH^3 entries of level i - 1.
+struct OccupancyLevel {
+    int blockCells;                  // Edge length of one entry, in grid cells
+    int dims[3];
+    std::vector<unsigned char> occupied;
+};
+
+// Uniform grid over the particles, sorted by cell (counting sort)
+struct ParticleGrid {
+    glm::vec3 origin;                // Lower corner of the grid
+    float cellSize;
+    int dims[3];
+    std::vector<int> cellStart;      // Particles of cell c are sorted[cellStart[c] .. cellStart[c + 1])
+    std::vector<glm::vec3> sorted;
+    OccupancyLevel levels[OCCUPANCY_LEVELS];
+
+    int cellIndex(int x, int y, int z) const { return (z * dims[1] + y) * dims[0] + x; }
+};
+
+void buildParticleGrid(const std::vector<glm::vec3>& positions, float h, ParticleGrid& grid) {
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    for (const glm::vec3& p : positions) {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    if (positions.empty()) lo = hi = glm::vec3(0.0f);
+
+    // Pad by one smoothing length: the density is zero outside this box
+    grid.origin = lo - glm::vec3(h);
+    grid.cellSize = h;
+    for (int a = 0; a < 3; a++) {
+        grid.dims[a] = std::max(1, (int)std::ceil((hi[a] - lo[a] + 2.0f * h) / h));
+    }
+    const int numCells = grid.dims[0] * grid.dims[1] * grid.dims[2];
+
+    std::vector<int> cellOf(positions.size());
+    grid.cellStart.assign(numCells + 1, 0);
+    for (size_t i = 0; i < positions.size(); i++) {
+        int c[3];
+        for (int a = 0; a < 3; a++) {
+            c[a] = std::min(grid.dims[a] - 1, (int)((positions[i][a] - grid.origin[a]) / h));
+        }
+        cellOf[i] = grid.cellIndex(c[0], c[1], c[2]);
+        grid.cellStart[cellOf[i] + 1]++;
+    }
+    for (int c = 0; c < numCells; c++) grid.cellStart[c + 1] += grid.cellStart[c];
+
+    std::vector<int> fill(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    grid.sorted.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        grid.sorted[fill[cellOf[i]]++] = positions[i];
+    }
+
+    // Level 0: a cell can have non-zero density if it or one of its 26 neighbours holds a particle
+    OccupancyLevel& base = grid.levels[0];
+    base.blockCells = 1;
+    for (int a = 0; a < 3; a++) base.dims[a] = grid.dims[a];
+    base.occupied.assign(numCells, 0);
+    for (int z = 0; z < grid.dims[2]; z++)
+        for (int y = 0; y < grid.dims[1]; y++)
+            for (int x = 0; x < grid.dims[0]; x++) {
+                int c = grid.cellIndex(x, y, z);
+                if (grid.cellStart[c] == grid.cellStart[c + 1]) continue;
+
+                for (int dz = std::max(z - 1, 0); dz <= std::min(z + 1, grid.dims[2] - 1); dz++)
+                    for (int dy = std::max(y - 1, 0); dy <= std::min(y + 1, grid.dims[1] - 1); dy++)
+                        for (int dx = std::max(x - 1, 0); dx <= std::min(x + 1, grid.dims[0] - 1); dx++)
+                            base.occupied[grid.cellIndex(dx, dy, dz)] = 1;
+            }
+
+    // Coarser levels: a block is occupied if any of its children is
+    for (int l = 1; l < OCCUPANCY_LEVELS; l++) {
+        const OccupancyLevel& fine = grid.levels[l - 1];
+        OccupancyLevel& coarse = grid.levels[l];
+        coarse.blockCells = fine.blockCells * OCCUPANCY_BRANCH;
+        for (int a = 0; a < 3; a++) coarse.dims[a] = (fine.dims[a] + OCCUPANCY_BRANCH - 1) / OCCUPANCY_BRANCH;
+        coarse.occupied.assign(coarse.dims[0] * coarse.dims[1] * coarse.dims[2], 0);
+
+        for (int z = 0; z < fine.dims[2]; z++)
+            for (int y = 0; y < fine.dims[1]; y++)
+                for (int x = 0; x < fine.dims[0]; x++) {
+                    if (!fine.occupied[(z * fine.dims[1] + y) * fine.dims[0] + x]) continue;
+                    int cx = x / OCCUPANCY_BRANCH, cy = y / OCCUPANCY_BRANCH, cz = z / OCCUPANCY_BRANCH;
+                    coarse.occupied[(cz * coarse.dims[1] + cy) * coarse.dims[0] + cx] = 1;
+                }
+    }
+}
+
+// Poly6 kernel constant 315 / (64 pi h^9), as in the SPH solver
+inline float poly6Constant(float h) {
+    return 315.0f / (64.0f * (float)M_PI * std::pow(h, 9.0f));
+}
+
+// Largest |dW/dr| of the poly6 kernel, reached at r = h / sqrt(5)
+inline float poly6MaxGradient(float h) {
+    return poly6Constant(h) * 6.0f * std::pow(h, 5.0f) * 16.0f / (25.0f * std::sqrt(5.0f));
+}
+
+struct DensitySample {
+    float density;
+    float nearest;                   // Distance to the nearest particle, capped at the query radius
+    int influencing;                 // Particles closer than the query radius
+};
+
+// Density at p, plus the data needed to bound the next step. Only particles within
+// `radius` (>= h) of p are visited.
+DensitySample sampleDensity(const ParticleGrid& grid, const glm::vec3& p, float h, float mass, float radius) {
+    DensitySample s;
+    s.density = 0.0f;
+    s.nearest = radius;
+    s.influencing = 0;
+
+    const float h2 = h * h;
+    const float r2max = radius * radius;
+    const float K = poly6Constant(h);
+
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; a++) {
+        lo[a] = std::max(0, (int)std::floor((p[a] - radius - grid.origin[a]) / grid.cellSize));
+        hi[a] = std::min(grid.dims[a] - 1, (int)std::floor((p[a] + radius - grid.origin[a]) / grid.cellSize));
+    }
+
+    for (int z = lo[2]; z <= hi[2]; z++)
+        for (int y = lo[1]; y <= hi[1]; y++)
+            for (int x = lo[0]; x <= hi[0]; x++) {
+                int c = grid.cellIndex(x, y, z);
+                for (int j = grid.cellStart[c]; j < grid.cellStart[c + 1]; j++) {
+                    glm::vec3 r = p - grid.sorted[j];
+                    float r2 = glm::dot(r, r);
+                    if (r2 >= r2max) continue;
+
+                    s.influencing++;
+                    s.nearest = std::min(s.nearest, std::sqrt(r2));
+                    if (r2 < h2) {
+                        float q = h2 - r2;
+                        s.density += mass * K * q * q * q;
+                    }
+                }
+            }
+    return s;
+}
+
+// Gradient of the density field; the surface normal is its negated direction
+glm::vec3 densityGradient(const ParticleGrid& grid, const glm::vec3& p, float h, float mass) {
+    glm::vec3 grad(0.0f);
+    const float h2 = h * h;
+    const float K = poly6Constant(h);
+
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; a++) {
+        lo[a] = std::max(0, (int)std::floor((p[a] - h - grid.origin[a]) / grid.cellSize));
+        hi[a] = std::min(grid.dims[a] - 1, (int)std::floor((p[a] + h - grid.origin[a]) / grid.cellSize));
+    }
+
+    for (int z = lo[2]; z <= hi[2]; z++)
+        for (int y = lo[1]; y <= hi[1]; y++)
+            for (int x = lo[0]; x <= hi[0]; x++) {
+                int c = grid.cellIndex(x, y, z);
+                for (int j = grid.cellStart[c]; j < grid.cellStart[c + 1]; j++) {
+                    glm::vec3 r = p - grid.sorted[j];
+                    float r2 = glm::dot(r, r);
+                    if (r2 >= h2) continue;
+
+                    float q = h2 - r2;
+                    grad += r * (-6.0f * mass * K * q * q);
+                }
+            }
+    return grad;
+}
+
+// Slab test. Returns false on a miss, otherwise the entry and exit distances along the ray.
+bool rayBoxSpan(const glm::vec3& origin, const glm::vec3& invDir, const glm::vec3& boxMin, const glm::vec3& boxMax,
+                float& tEnter, float& tExit) {
+    tEnter = 0.0f;
+    tExit = std::numeric_limits<float>::max();
+    for (int a = 0; a < 3; a++) {
+        float t0 = (boxMin[a] - origin[a]) * invDir[a];
+        float t1 = (boxMax[a] - origin[a]) * invDir[a];
+        if (t0 > t1) std::swap(t0, t1);
+        tEnter = std::max(tEnter, t0);
+        tExit = std::min(tExit, t1);
+    }
+    return tEnter <= tExit;
+}
+
+// If p lies in an empty region of the occupancy hierarchy, returns the distance
+// along the ray to the far side of the largest empty block containing p. Returns 0
+// when p is in an occupied cell.
+float emptySpaceSkip(const ParticleGrid& grid, const glm::vec3& p, const glm::vec3& origin, const glm::vec3& invDir, float t) {
+    int cell[3];
+    for (int a = 0; a < 3; a++) {
+        cell[a] = std::min(grid.dims[a] - 1, std::max(0, (int)((p[a] - grid.origin[a]) / grid.cellSize)));
+    }
+
+    for (int l = OCCUPANCY_LEVELS - 1; l >= 0; l--) {
+        const OccupancyLevel& level = grid.levels[l];
+        int b[3];
+        for (int a = 0; a < 3; a++) b[a] = cell[a] / level.blockCells;
+        if (level.occupied[(b[2] * level.dims[1] + b[1]) * level.dims[0] + b[0]]) continue;
+
+        // Empty block: jump to where the ray leaves it
+        glm::vec3 blockMin, blockMax;
+        for (int a = 0; a < 3; a++) {
+            blockMin[a] = grid.origin[a] + b[a] * level.blockCells * grid.cellSize;
+            blockMax[a] = blockMin[a] + level.blockCells * grid.cellSize;
+        }
+        float tEnter, tExit;
+        rayBoxSpan(origin, invDir, blockMin, blockMax, tEnter, tExit);
+        return std::max(tExit - t, 0.0f) + 1e-4f * grid.cellSize;
+    }
+    return 0.0f;
+}
+
+// Marches one ray through the density field. On a hit returns true and the hit position.
+bool traceFluidSurface(const ParticleGrid& grid, const glm::vec3& origin, const glm::vec3& dir,
+                       const RayMarchSettings& settings, glm::vec3& hitPos) {
+    glm::vec3 invDir;
+    for (int a = 0; a < 3; a++) {
+        invDir[a] = dir[a] != 0.0f ? 1.0f / dir[a] : std::numeric_limits<float>::max();
+    }
+
+    glm::vec3 gridMax;
+    for (int a = 0; a < 3; a++) gridMax[a] = grid.origin[a] + grid.dims[a] * grid.cellSize;
+    float t, tEnd;
+    if (!rayBoxSpan(origin, invDir, grid.origin, gridMax, t, tEnd)) return false;
+
+    const float h = settings.h;
+    const float maxStep = 0.5f * h;
+    const float queryRadius = h + maxStep;      // Particles that can affect rho anywhere within maxStep of p
+    const float lipschitzPerParticle = settings.mass * poly6MaxGradient(h);
+
+    float tPrev = t;
+    for (int step = 0; step < settings.maxSteps && t <= tEnd; step++) {
+        glm::vec3 p = origin + dir * t;
+
+        float skip = emptySpaceSkip(grid, p, origin, invDir, t);
+        if (skip > 0.0f) {
+            tPrev = t;
+            t += skip;
+            continue;
+        }
+
+        DensitySample s = sampleDensity(grid, p, h, settings.mass, queryRadius);
+        if (s.density >= settings.isoDensity) {
+            // Crossed the surface between tPrev and t: refine by bisection
+            float a = tPrev, b = t;
+            for (int i = 0; i < 8; i++) {
+                float mid = 0.5f * (a + b);
+                if (sampleDensity(grid, origin + dir * mid, h, settings.mass, h).density >= settings.isoDensity) b = mid;
+                else a = mid;
+            }
+            hitPos = origin + dir * b;
+            return true;
+        }
+
+        float advance;
+        if (s.nearest > h) {
+            // No particle within h: the field is zero in a ball of radius nearest - h
+            advance = s.nearest - h;
+        } else {
+            // rho changes by at most L per unit length inside the maxStep ball
+            float L = s.influencing * lipschitzPerParticle;
+            advance = std::min((settings.isoDensity - s.density) / L, maxStep);
+        }
+        tPrev = t;
+        t += std::max(advance, settings.minStep);
+    }
+    return false;
+}
+
+glm::vec3 shadeFluid(const ParticleGrid& grid, const glm::vec3& p, const glm::vec3& viewDir, const RayMarchSettings& settings) {
+    glm::vec3 grad = densityGradient(grid, p, settings.h, settings.mass);
+    float len = glm::length(grad);
+    glm::vec3 n = len > 0.0f ? -grad / len : -viewDir;
+    glm::vec3 l = glm::normalize(settings.lightDir);
+
+    float diffuse = std::max(glm::dot(n, l), 0.0f);
+    glm::vec3 halfVec = glm::normalize(l - viewDir);
+    float specular = std::pow(std::max(glm::dot(n, halfVec), 0.0f), 64.0f);
+    return settings.fluidColor * (0.15f + 0.85f * diffuse) + glm::vec3(specular);
+}
+
+// Renders the SPH fluid surface straight from particle positions. image receives
+// width * height colors, row 0 at the top.
+void rayMarchFluid(const std::vector<glm::vec3>& positions, const RayMarchCamera& camera,
+                   const RayMarchSettings& settings, std::vector<glm::vec3>& image) {
+    ParticleGrid grid;
+    buildParticleGrid(positions, settings.h, grid);
+
+    int numThreads = settings.numThreads > 0 ? settings.numThreads : (int)std::thread::hardware_concurrency();
+    if (numThreads <= 0) numThreads = 1;
+
+    image.assign(settings.width * settings.height, settings.background);
+
+    glm::vec3 forward = glm::normalize(camera.target - camera.position);
+    glm::vec3 right = glm::normalize(glm::cross(forward, camera.up));
+    glm::vec3 up = glm::cross(right, forward);
+    float halfH = std::tan(0.5f * camera.fovY);
+    float halfW = halfH * settings.width / (float)settings.height;
+
+    const int tilesX = (settings.width + RM_TILE_SIZE - 1) / RM_TILE_SIZE;
+    const int tilesY = (settings.height + RM_TILE_SIZE - 1) / RM_TILE_SIZE;
+    const int numTiles = tilesX * tilesY;
+
+    // Threads pull tiles from a shared counter; rays near the fluid cost far more than empty ones
+    std::atomic<int> nextTile(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numThreads; t++) {
+        workers.emplace_back([&]() {
+            for (int tile = nextTile++; tile < numTiles; tile = nextTile++) {
+                int x0 = (tile % tilesX) * RM_TILE_SIZE;
+                int y0 = (tile / tilesX) * RM_TILE_SIZE;
+                int x1 = std::min(x0 + RM_TILE_SIZE, settings.width);
+                int y1 = std::min(y0 + RM_TILE_SIZE, settings.height);
+
+                for (int y = y0; y < y1; y++) {
+                    for (int x = x0; x < x1; x++) {
+                        float u = (2.0f * (x + 0.5f) / settings.width - 1.0f) * halfW;
+                        float v = (1.0f - 2.0f * (y + 0.5f) / settings.height) * halfH;
+                        glm::vec3 dir = glm::normalize(forward + right * u + up * v);
+
+                        glm::vec3 hit;
+                        if (traceFluidSurface(grid, camera.position, dir, settings, hit)) {
+                            image[y * settings.width + x] = shadeFluid(grid, hit, dir, settings);
+                        }
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& w : workers) w.join();
+}
+
+
+
+
+
+//example
+//    RayMarchCamera camera;
+//    camera.position = glm::vec3(0.0f, 0.5f, 2.0f);
+//    camera.target = glm::vec3(0.0f);
+//    camera.up = glm::vec3(0.0f, 1.0f, 0.0f);
+//    camera.fovY = 0.8f;
+//
+//    RayMarchSettings settings;
+//    settings.h = h;
+//    settings.mass = particles[0].mass;
+//    settings.isoDensity = 0.5f * rho0;
+//
+//    std::vector<glm::vec3> image;
+//    rayMarchFluid(positions, camera, settings, image);   // positions copied back from the SPH solver
+//
+//The buildParticleGrid function sorts the particles into a uniform grid with cells one smoothing length
+//wide, so a density lookup only visits nearby cells. It also builds the occupancy hierarchy: a cell is
+//occupied when it or a neighbouring cell holds a particle (any other cell is farther than h from every
+//particle, so its density is zero), and each coarser level marks a 4x4x4 block as occupied when any
+//child is.
+//
+//The traceFluidSurface function clips the ray to the grid, then loops: in an empty block it jumps to the
+//block exit; in an occupied cell it samples the density. Once the density reaches isoDensity the hit is
+//refined by bisection between the last two samples. Otherwise the step is the distance to the kernel
+//support of the nearest particle, or (isoDensity - rho) / L where L bounds |grad rho| from the particles
+//that can reach the next half smoothing length.
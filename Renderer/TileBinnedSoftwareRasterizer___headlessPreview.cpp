@@ -0,0 +1,414 @@
+// Rasterization is the computationally affordable render path of the engine,
+// but the SPH previews draw through GLFW and glDrawArrays(GL_POINTS), so they
+// need a GPU driver and a window. This file is a CPU-only rasterizer for
+// headless machines.
+//
+// The screen is split into square tiles. Every primitive (particle splat or
+// triangle) is first projected and "binned" into the tiles its screen bounding
+// box overlaps. Then the tiles are rendered in parallel: each thread takes a
+// tile from a shared counter, and since no two threads ever touch the same
+// tile, the color and depth buffers need no locks.
+//
+// Triangles are filled with edge functions evaluated four pixels at a time
+// with SSE (plain scalar code is used when SSE is not available).
+// Particles are drawn as round depth-tested splats, colored by density the
+// same way as the host color loop in the SPH simulation.
+
+
+
+
+
+
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CRATER_RASTER_SSE 1
+#endif
+
+const int TILE_SIZE = 32;        // Tile edge length in pixels
+
+struct Framebuffer {
+    int width;
+    int height;
+    std::vector<glm::vec3> color;
+    std::vector<float> depth;    // Window-space depth, 0 = near plane, 1 = far plane
+
+    Framebuffer(int w, int h) : width(w), height(h), color(w * h, glm::vec3(0.0f)), depth(w * h, 1.0f) {}
+
+    void clear(const glm::vec3& clearColor) {
+        std::fill(color.begin(), color.end(), clearColor);
+        std::fill(depth.begin(), depth.end(), 1.0f);
+    }
+};
+
+struct RasterTriangle {
+    int v0;
+    int v1;
+    int v2;
+};
+
+struct RasterSettings {
+    int numThreads;              // <= 0 uses every hardware thread
+    float pointSize;             // Splat diameter in pixels, like glPointSize
+
+    RasterSettings() : numThreads(0), pointSize(2.0f) {}
+};
+
+// Vertex after the viewport transform: x and y in pixels, z in [0, 1]
+struct ScreenVertex {
+    glm::vec3 pos;
+    glm::vec3 col;
+    bool visible;
+};
+
+// Per-thread list of primitive indices for every tile
+struct TileBins {
+    std::vector<std::vector<int>> points;
+    std::vector<std::vector<int>> triangles;
+};
+
+// Same ramp as the host loop in the SPH simulation:
+// green -> red below the reference density, red -> yellow above it.
+glm::vec3 densityToColor(float density, float rho0) {
+    if (density < rho0) {
+        return glm::mix(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), std::max(density / rho0, 0.0f));
+    }
+    return glm::mix(glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f), std::min((density - rho0) / rho0, 1.0f));
+}
+
+ScreenVertex projectVertex(const glm::mat4& viewProj, const glm::vec3& p, const glm::vec3& col, int width, int height) {
+    ScreenVertex sv;
+    sv.col = col;
+
+    glm::vec4 clip = viewProj * glm::vec4(p, 1.0f);
+    if (clip.w <= 1e-6f) {
+        // Behind the camera
+        sv.pos = glm::vec3(0.0f);
+        sv.visible = false;
+        return sv;
+    }
+
+    float invW = 1.0f / clip.w;
+    sv.pos = glm::vec3((clip.x * invW * 0.5f + 0.5f) * width,
+                       (0.5f - clip.y * invW * 0.5f) * height,
+                       clip.z * invW * 0.5f + 0.5f);
+    sv.visible = sv.pos.z >= 0.0f && sv.pos.z <= 1.0f;
+    return sv;
+}
+
+// Runs fn(begin, end, threadIdx) over [0, count) split into one contiguous chunk per thread
+template <typename Fn>
+void parallelChunks(int count, int numThreads, Fn fn) {
+    std::vector<std::thread> workers;
+    int chunk = (count + numThreads - 1) / numThreads;
+    for (int t = 0; t < numThreads; t++) {
+        int begin = std::min(t * chunk, count);
+        int end = std::min(begin + chunk, count);
+        workers.emplace_back(fn, begin, end, t);
+    }
+    for (std::thread& w : workers) w.join();
+}
+
+// Edge functions of a triangle in the form w = A * x + B * y + C.
+// w_i is the weight of vertex i; all three are >= 0 inside the triangle.
+struct EdgeSetup {
+    float A[3];
+    float B[3];
+    float C[3];
+    float z[3];
+    float invArea;
+};
+
+bool setupTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2, EdgeSetup& e) {
+    const glm::vec3* p[3] = { &v0.pos, &v1.pos, &v2.pos };
+
+    float area = (p[1]->x - p[0]->x) * (p[2]->y - p[0]->y) - (p[1]->y - p[0]->y) * (p[2]->x - p[0]->x);
+    if (std::fabs(area) < 1e-8f) return false;   // Degenerate triangle
+
+    for (int i = 0; i < 3; i++) {
+        // Edge opposite vertex i goes from vertex i+1 to vertex i+2
+        const glm::vec3& a = *p[(i + 1) % 3];
+        const glm::vec3& b = *p[(i + 2) % 3];
+        e.A[i] = a.y - b.y;
+        e.B[i] = b.x - a.x;
+        e.C[i] = a.x * b.y - a.y * b.x;
+        e.z[i] = p[i]->z;
+    }
+
+    // No back-face culling: flip the edges of clockwise triangles so "inside" is always w >= 0
+    if (area < 0.0f) {
+        for (int i = 0; i < 3; i++) {
+            e.A[i] = -e.A[i];
+            e.B[i] = -e.B[i];
+            e.C[i] = -e.C[i];
+        }
+        area = -area;
+    }
+    e.invArea = 1.0f / area;
+    return true;
+}
+
+// Evaluates the edge functions at four horizontally adjacent pixel centres starting
+// at (px, py). Writes the barycentrics of vertices 0 and 1 plus the interpolated
+// depth for each lane, and returns the coverage as a 4-bit mask.
+inline int coverage4(const EdgeSetup& e, float px, float py, float b0[4], float b1[4], float z[4]) {
+#ifdef CRATER_RASTER_SSE
+    const __m128 xs = _mm_add_ps(_mm_set1_ps(px), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+    const __m128 ys = _mm_set1_ps(py);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 invArea = _mm_set1_ps(e.invArea);
+
+    __m128 w[3];
+    for (int i = 0; i < 3; i++) {
+        w[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e.A[i]), xs),
+                                     _mm_mul_ps(_mm_set1_ps(e.B[i]), ys)),
+                          _mm_set1_ps(e.C[i]));
+    }
+    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w[0], zero), _mm_cmpge_ps(w[1], zero)),
+                               _mm_cmpge_ps(w[2], zero));
+
+    __m128 l0 = _mm_mul_ps(w[0], invArea);
+    __m128 l1 = _mm_mul_ps(w[1], invArea);
+    __m128 l2 = _mm_mul_ps(w[2], invArea);
+    __m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, _mm_set1_ps(e.z[0])),
+                                         _mm_mul_ps(l1, _mm_set1_ps(e.z[1]))),
+                              _mm_mul_ps(l2, _mm_set1_ps(e.z[2])));
+    _mm_storeu_ps(b0, l0);
+    _mm_storeu_ps(b1, l1);
+    _mm_storeu_ps(z, depth);
+    return _mm_movemask_ps(inside);
+#else
+    int mask = 0;
+    for (int lane = 0; lane < 4; lane++) {
+        float x = px + lane;
+        float w0 = e.A[0] * x + e.B[0] * py + e.C[0];
+        float w1 = e.A[1] * x + e.B[1] * py + e.C[1];
+        float w2 = e.A[2] * x + e.B[2] * py + e.C[2];
+        if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) mask |= 1 << lane;
+        b0[lane] = w0 * e.invArea;
+        b1[lane] = w1 * e.invArea;
+        z[lane] = (w0 * e.z[0] + w1 * e.z[1] + w2 * e.z[2]) * e.invArea;
+    }
+    return mask;
+#endif
+}
+
+void rasterTriangleInTile(Framebuffer& fb, const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2,
+                          int tx0, int ty0, int tx1, int ty1) {
+    EdgeSetup e;
+    if (!setupTriangle(v0, v1, v2, e)) return;
+
+    // Triangle bounding box clipped to the tile
+    int x0 = std::max(tx0, (int)std::floor(std::min(std::min(v0.pos.x, v1.pos.x), v2.pos.x)));
+    int y0 = std::max(ty0, (int)std::floor(std::min(std::min(v0.pos.y, v1.pos.y), v2.pos.y)));
+    int x1 = std::min(tx1, (int)std::ceil(std::max(std::max(v0.pos.x, v1.pos.x), v2.pos.x)));
+    int y1 = std::min(ty1, (int)std::ceil(std::max(std::max(v0.pos.y, v1.pos.y), v2.pos.y)));
+
+    float b0[4], b1[4], z[4];
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x += 4) {
+            int mask = coverage4(e, x + 0.5f, y + 0.5f, b0, b1, z);
+            // Drop the lanes past the right edge of the tile
+            if (x1 - x < 4) mask &= (1 << (x1 - x)) - 1;
+
+            while (mask) {
+                int lane = 0;
+                while (!(mask & (1 << lane))) lane++;
+                mask &= ~(1 << lane);
+
+                int idx = y * fb.width + x + lane;
+                if (z[lane] < fb.depth[idx]) {
+                    fb.depth[idx] = z[lane];
+                    fb.color[idx] = v0.col * b0[lane] + v1.col * b1[lane] + v2.col * (1.0f - b0[lane] - b1[lane]);
+                }
+            }
+        }
+    }
+}
+
+void splatPointInTile(Framebuffer& fb, const ScreenVertex& v, float radius, int tx0, int ty0, int tx1, int ty1) {
+    int x0 = std::max(tx0, (int)std::floor(v.pos.x - radius));
+    int y0 = std::max(ty0, (int)std::floor(v.pos.y - radius));
+    int x1 = std::min(tx1, (int)std::ceil(v.pos.x + radius));
+    int y1 = std::min(ty1, (int)std::ceil(v.pos.y + radius));
+    float r2 = radius * radius;
+
+    for (int y = y0; y < y1; y++) {
+        float dy = y + 0.5f - v.pos.y;
+        for (int x = x0; x < x1; x++) {
+            float dx = x + 0.5f - v.pos.x;
+            if (dx * dx + dy * dy > r2) continue;   // Round splat, like smoothed GL_POINTS
+
+            int idx = y * fb.width + x;
+            if (v.pos.z < fb.depth[idx]) {
+                fb.depth[idx] = v.pos.z;
+                fb.color[idx] = v.col;
+            }
+        }
+    }
+}
+
+// Screen-space tile range [tx0, tx1) x [ty0, ty1) covered by a pixel bounding box
+inline void tileRange(float minX, float minY, float maxX, float maxY, int tilesX, int tilesY,
+                      int& tx0, int& ty0, int& tx1, int& ty1) {
+    tx0 = std::max(0, (int)std::floor(minX) / TILE_SIZE);
+    ty0 = std::max(0, (int)std::floor(minY) / TILE_SIZE);
+    tx1 = std::min(tilesX, (int)std::ceil(maxX) / TILE_SIZE + 1);
+    ty1 = std::min(tilesY, (int)std::ceil(maxY) / TILE_SIZE + 1);
+}
+
+// Renders colored points and an indexed triangle mesh into fb. The caller clears fb.
+// Triangles with a vertex behind the camera are dropped (no near-plane clipping).
+void rasterize(Framebuffer& fb, const glm::mat4& viewProj,
+               const std::vector<glm::vec3>& pointPositions, const std::vector<glm::vec3>& pointColors,
+               const std::vector<glm::vec3>& meshVertices, const std::vector<glm::vec3>& meshColors,
+               const std::vector<RasterTriangle>& triangles, const RasterSettings& settings) {
+    int numThreads = settings.numThreads > 0 ? settings.numThreads : (int)std::thread::hardware_concurrency();
+    if (numThreads <= 0) numThreads = 1;
+
+    const int tilesX = (fb.width + TILE_SIZE - 1) / TILE_SIZE;
+    const int tilesY = (fb.height + TILE_SIZE - 1) / TILE_SIZE;
+    const int numTiles = tilesX * tilesY;
+    const float radius = 0.5f * settings.pointSize;
+
+    // Project every vertex once
+    std::vector<ScreenVertex> screenPoints(pointPositions.size());
+    std::vector<ScreenVertex> screenVerts(meshVertices.size());
+    parallelChunks((int)pointPositions.size(), numThreads, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++) {
+            screenPoints[i] = projectVertex(viewProj, pointPositions[i], pointColors[i], fb.width, fb.height);
+        }
+    });
+    parallelChunks((int)meshVertices.size(), numThreads, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++) {
+            screenVerts[i] = projectVertex(viewProj, meshVertices[i], meshColors[i], fb.width, fb.height);
+        }
+    });
+
+    // Bin primitives into tiles. Each thread fills its own bins from a contiguous
+    // range of primitives, so binning needs no locks and keeps submission order.
+    std::vector<TileBins> bins(numThreads);
+    for (TileBins& b : bins) {
+        b.points.resize(numTiles);
+        b.triangles.resize(numTiles);
+    }
+    parallelChunks((int)pointPositions.size(), numThreads, [&](int begin, int end, int t) {
+        for (int i = begin; i < end; i++) {
+            const ScreenVertex& v = screenPoints[i];
+            if (!v.visible) continue;
+
+            int tx0, ty0, tx1, ty1;
+            tileRange(v.pos.x - radius, v.pos.y - radius, v.pos.x + radius, v.pos.y + radius,
+                      tilesX, tilesY, tx0, ty0, tx1, ty1);
+            for (int ty = ty0; ty < ty1; ty++)
+                for (int tx = tx0; tx < tx1; tx++)
+                    bins[t].points[ty * tilesX + tx].push_back(i);
+        }
+    });
+    parallelChunks((int)triangles.size(), numThreads, [&](int begin, int end, int t) {
+        for (int i = begin; i < end; i++) {
+            const ScreenVertex& a = screenVerts[triangles[i].v0];
+            const ScreenVertex& b = screenVerts[triangles[i].v1];
+            const ScreenVertex& c = screenVerts[triangles[i].v2];
+            if (!a.visible || !b.visible || !c.visible) continue;
+
+            int tx0, ty0, tx1, ty1;
+            tileRange(std::min(std::min(a.pos.x, b.pos.x), c.pos.x), std::min(std::min(a.pos.y, b.pos.y), c.pos.y),
+                      std::max(std::max(a.pos.x, b.pos.x), c.pos.x), std::max(std::max(a.pos.y, b.pos.y), c.pos.y),
+                      tilesX, tilesY, tx0, ty0, tx1, ty1);
+            for (int ty = ty0; ty < ty1; ty++)
+                for (int tx = tx0; tx < tx1; tx++)
+                    bins[t].triangles[ty * tilesX + tx].push_back(i);
+        }
+    });
+
+    // Render tiles in parallel. Threads pull tiles from a shared counter, so dense
+    // tiles do not stall the others, and every pixel belongs to exactly one thread.
+    std::atomic<int> nextTile(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numThreads; t++) {
+        workers.emplace_back([&]() {
+            for (int tile = nextTile++; tile < numTiles; tile = nextTile++) {
+                int tx0 = (tile % tilesX) * TILE_SIZE;
+                int ty0 = (tile / tilesX) * TILE_SIZE;
+                int tx1 = std::min(tx0 + TILE_SIZE, fb.width);
+                int ty1 = std::min(ty0 + TILE_SIZE, fb.height);
+
+                for (const TileBins& b : bins) {
+                    for (int i : b.triangles[tile]) {
+                        const RasterTriangle& tri = triangles[i];
+                        rasterTriangleInTile(fb, screenVerts[tri.v0], screenVerts[tri.v1], screenVerts[tri.v2],
+                                             tx0, ty0, tx1, ty1);
+                    }
+                    for (int i : b.points[tile]) {
+                        splatPointInTile(fb, screenPoints[i], radius, tx0, ty0, tx1, ty1);
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& w : workers) w.join();
+}
+
+// Particle preview: shades every particle by its density and splats it
+void rasterizeParticles(Framebuffer& fb, const glm::mat4& viewProj,
+                        const std::vector<glm::vec3>& positions, const std::vector<float>& densities,
+                        float rho0, const RasterSettings& settings) {
+    std::vector<glm::vec3> colors(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        colors[i] = densityToColor(densities[i], rho0);
+    }
+
+    rasterize(fb, viewProj, positions, colors,
+              std::vector<glm::vec3>(), std::vector<glm::vec3>(), std::vector<RasterTriangle>(), settings);
+}
+
+// Writes the color buffer as a binary PPM, so dailies need no image library
+bool writePPM(const Framebuffer& fb, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+
+    fprintf(f, "P6\n%d %d\n255\n", fb.width, fb.height);
+    std::vector<unsigned char> row(fb.width * 3);
+    for (int y = 0; y < fb.height; y++) {
+        for (int x = 0; x < fb.width; x++) {
+            const glm::vec3& c = fb.color[y * fb.width + x];
+            row[x * 3 + 0] = (unsigned char)(std::min(std::max(c.x, 0.0f), 1.0f) * 255.0f + 0.5f);
+            row[x * 3 + 1] = (unsigned char)(std::min(std::max(c.y, 0.0f), 1.0f) * 255.0f + 0.5f);
+            row[x * 3 + 2] = (unsigned char)(std::min(std::max(c.z, 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+        fwrite(row.data(), 1, row.size(), f);
+    }
+    fclose(f);
+    return true;
+}
+
+
+
+
+
+//example
+//    Framebuffer fb(1920, 1080);
+//    fb.clear(glm::vec3(0.0f));
+//
+//    RasterSettings settings;
+//    settings.pointSize = 2.0f;
+//
+//    // positions and densities copied back from the SPH solver with cudaMemcpy
+//    rasterizeParticles(fb, projection * view, positions, densities, rho0, settings);
+//    writePPM(fb, "frame_0001.ppm");
+//
+//The rasterize function works in three passes. First every point and mesh vertex is projected to
+//screen space. Then each primitive is added to the bin of every tile its bounding box touches; each
+//thread bins its own range of primitives into private bins. Finally the threads render whole tiles,
+//going through the bins of all threads in order, so the result does not depend on the thread count.
+//
+//Depth is tested per pixel against a float depth buffer in [0, 1]. Triangle coverage, barycentrics
+//and depth are computed for four pixels at once with SSE; only covered pixels are depth tested and written.